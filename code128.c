@@ -521,6 +521,22 @@ size_t code128_encode_raw(const char *s, char *out, size_t maxlength)
     return actual_length;
 }
 
+// Convert [FNC1] sequences to raw FNC1 characters and remove spaces.
+// raw must have room for strlen(s) + 1 characters.
+static void code128_gs1_to_raw(const char *s, char *raw)
+{
+    char *p = raw;
+    for (; *s != '\0'; s++) {
+        if (strncmp(s, "[FNC1]", 6) == 0) {
+            *p++ = CODE128_FNC1;
+            s += 5;
+        } else if (*s != ' ') {
+            *p++ = *s;
+        }
+    }
+    *p = '\0';
+}
+
 /**
  * @brief Encode the GS1 string
  *
@@ -533,16 +549,602 @@ size_t code128_encode_gs1(const char *s, char *out, size_t maxlength)
 {
     char raw[strlen(s) + 1];
 
-    char *p = raw;
-    for (; *s != '\0'; s++) {
-        if (strncmp(s, "[FNC1]", 6) == 0) {
-            *p++ = CODE128_FNC1;
-            s += 5;
-        } else if (*s != ' ') {
-            *p++ = *s;
+    code128_gs1_to_raw(s, raw);
+    return code128_encode_raw(raw, out, maxlength);
+}
+
+// Number of digits in the application identifier starting with the
+// given two digits. Unassigned prefixes are treated as 2 digit AIs.
+static int code128_gs1_ai_len(int prefix)
+{
+    if ((prefix >= 23 && prefix <= 25) ||
+            (prefix >= 40 && prefix <= 42) ||
+            prefix == 71)
+        return 3;
+
+    if ((prefix >= 31 && prefix <= 36) ||
+            prefix == 39 || prefix == 43 ||
+            prefix == 70 || prefix == 72 ||
+            (prefix >= 80 && prefix <= 82))
+        return 4;
+
+    return 2;
+}
+
+// Length of the AI plus its data for AIs that are never followed by an
+// FNC1 separator, or 0 if the data ends at the next FNC1.
+static int code128_gs1_fixed_len(int prefix)
+{
+    if (prefix == 0)
+        return 20;
+    if (prefix >= 1 && prefix <= 3)
+        return 16;
+    if (prefix == 4)
+        return 18;
+    if (prefix >= 11 && prefix <= 19)
+        return 8;
+    if (prefix == 20)
+        return 4;
+    if (prefix >= 31 && prefix <= 36)
+        return 10;
+    if (prefix == 41)
+        return 16;
+    return 0;
+}
+
+/**
+ * @brief Make the human readable interpretation of a GS1 string
+ *
+ * The string is parsed the same way as code128_encode_gs1() does. If it
+ * starts with FNC1, the AIs are put in parentheses, e.g.
+ * "[FNC1] 00 12345678 0000000001" becomes "(00)123456780000000001".
+ * Otherwise the printable characters are copied as is.
+ *
+ * @param maxlength the size of out. 2 * strlen(s) + 1 is always enough.
+ * @return the length of the text written to out or 0 if it didn't fit
+ */
+size_t code128_gs1_hri(const char *s, char *out, size_t maxlength)
+{
+    char raw[strlen(s) + 1];
+    const char *p = raw;
+    size_t len = 0;
+
+    code128_gs1_to_raw(s, raw);
+
+#define CODE128_HRI_PUT(c) do { \
+        if (len + 1 >= maxlength) \
+            return 0; \
+        out[len++] = (c); \
+    } while (0)
+
+    if (*p != CODE128_FNC1) {
+        for (; *p != '\0'; p++) {
+            if (*p >= ' ' && *p <= '~')
+                CODE128_HRI_PUT(*p);
+        }
+    } else {
+        while (*p != '\0') {
+            if (*p == CODE128_FNC1) {
+                p++;
+                continue;
+            }
+
+            if (!(p[0] >= '0' && p[0] <= '9' && p[1] >= '0' && p[1] <= '9')) {
+                // Not an AI, so show the rest without trying to split it up
+                for (; *p != '\0'; p++) {
+                    if (*p >= ' ' && *p <= '~')
+                        CODE128_HRI_PUT(*p);
+                }
+                break;
+            }
+
+            int prefix = 10 * (p[0] - '0') + (p[1] - '0');
+            int ai_len = code128_gs1_ai_len(prefix);
+            int data_len = code128_gs1_fixed_len(prefix);
+            int i;
+
+            CODE128_HRI_PUT('(');
+            for (i = 0; i < ai_len && *p != '\0' && *p != CODE128_FNC1; i++)
+                CODE128_HRI_PUT(*p++);
+            CODE128_HRI_PUT(')');
+
+            data_len = data_len ? data_len - ai_len : -1;
+            for (i = 0; i != data_len && *p != '\0' && *p != CODE128_FNC1; i++) {
+                if (*p >= ' ' && *p <= '~')
+                    CODE128_HRI_PUT(*p);
+                p++;
+            }
         }
     }
-    *p = '\0';
 
-    return code128_encode_raw(raw, out, maxlength);
+#undef CODE128_HRI_PUT
+
+    if (maxlength == 0)
+        return 0;
+    out[len] = '\0';
+    return len;
+}
+
+// Mode indices used by the streaming encoder's search. CODE128_NO_MODE is
+// the state before the start code has been chosen.
+#define CODE128_NO_MODE 3
+
+static const char code128_mode_of_index[] = {
+    CODE128_MODE_A, CODE128_MODE_B, CODE128_MODE_C, 0
+};
+
+struct code128_node
+{
+    int cost;                   // Number of codes to get here, or -1 if unreachable
+    char prev_mode;             // Mode index of the previous node
+    char code;                  // What code gets written for this node
+};
+
+static int code128_mode_index(char mode)
+{
+    switch (mode) {
+    case CODE128_MODE_A:
+        return 0;
+    case CODE128_MODE_B:
+        return 1;
+    case CODE128_MODE_C:
+        return 2;
+    default:
+        return CODE128_NO_MODE;
+    }
+}
+
+// Number of input characters consumed by a node
+static int code128_node_width(int mode, char code)
+{
+    return (mode == 2 && code < 100) ? 2 : 1;
+}
+
+static void code128_relax(struct code128_node *to, int to_mode,
+                          const struct code128_node *from, int from_mode, char code)
+{
+    if (code < 0)
+        return;
+
+    // Entering a new mode costs a start or switch code
+    int cost = from->cost + 1 + (from_mode != to_mode);
+    if (to->cost < 0 || cost < to->cost) {
+        to->cost = cost;
+        to->prev_mode = from_mode;
+        to->code = code;
+    }
+}
+
+// Find the shortest encoding of every prefix of the window for every mode,
+// starting from the mode of the last code written.
+static void code128_search_window(const struct code128_stream *st,
+                                  struct code128_node nodes[][4])
+{
+    int n = st->window_len;
+    int i, m;
+
+    for (i = 0; i <= n; i++)
+        for (m = 0; m < 4; m++)
+            nodes[i][m].cost = -1;
+    nodes[0][code128_mode_index(st->mode)].cost = 0;
+
+    for (i = 0; i < n; i++) {
+        const char *in = &st->window[i];
+        for (m = 0; m < 4; m++) {
+            const struct code128_node *from = &nodes[i][m];
+            if (from->cost < 0)
+                continue;
+
+            code128_relax(&nodes[i + 1][0], 0, from, m, code128a_ascii_to_code(*in));
+            code128_relax(&nodes[i + 1][1], 1, from, m, code128b_ascii_to_code(*in));
+            if (*in == CODE128_FNC1)
+                code128_relax(&nodes[i + 1][2], 2, from, m, 102);
+            else if (i + 1 < n)
+                code128_relax(&nodes[i + 2][2], 2, from, m, code128c_ascii_to_code(in));
+        }
+    }
+}
+
+// Walk back from nodes[pos][*mode] to the node right after the root.
+static int code128_first_node(struct code128_node nodes[][4], int pos, int *mode)
+{
+    int m = *mode;
+    for (;;) {
+        int prev = pos - code128_node_width(m, nodes[pos][m].code);
+        if (prev == 0)
+            break;
+        m = nodes[pos][m].prev_mode;
+        pos = prev;
+    }
+    *mode = m;
+    return pos;
+}
+
+// List the nodes that more input could continue from. Every encoding of
+// the full input goes through a node at the end of the window, or through
+// one just before it when the last character might pair up with the next
+// one in mode C.
+static int code128_live_nodes(const struct code128_stream *st, struct code128_node nodes[][4],
+                              int *live_pos, int *live_mode)
+{
+    int n = st->window_len;
+    int count = 0;
+    int pos, m;
+
+    for (pos = n; pos >= 0 && pos >= n - 1; pos--) {
+        if (pos == n - 1 && !(st->window[pos] >= '0' && st->window[pos] <= '9'))
+            break;
+
+        for (m = 0; m < 4; m++) {
+            if (nodes[pos][m].cost >= 0) {
+                live_pos[count] = pos;
+                live_mode[count] = m;
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+// If the shortest encodings of all live nodes start the same way, return
+// that first node. Otherwise return 0.
+static int code128_common_first_node(struct code128_node nodes[][4], int live_count,
+                                     const int *live_pos, const int *live_mode, int *mode)
+{
+    int first_pos = 0;
+    int i;
+
+    for (i = 0; i < live_count; i++) {
+        if (live_pos[i] == 0)
+            return 0; // Nothing has been decided yet
+
+        int m = live_mode[i];
+        int pos = code128_first_node(nodes, live_pos[i], &m);
+        if (first_pos == 0) {
+            first_pos = pos;
+            *mode = m;
+        } else if (pos != first_pos || m != *mode) {
+            return 0;
+        }
+    }
+    return first_pos;
+}
+
+// Pick a first node when the window is full and the live nodes still
+// disagree. This follows the live node with the shortest encoding so far.
+static int code128_choose_first_node(const struct code128_stream *st, struct code128_node nodes[][4],
+                                     int live_count, const int *live_pos, const int *live_mode,
+                                     int *mode)
+{
+    int best = 0;
+    int best_cost = 0;
+    int i;
+
+    for (i = 0; i < live_count; i++) {
+        // Nodes before the end of the window need at least one more code
+        int cost = nodes[live_pos[i]][live_mode[i]].cost + (st->window_len - live_pos[i]);
+        if (i == 0 || cost < best_cost) {
+            best = i;
+            best_cost = cost;
+        }
+    }
+
+    *mode = live_mode[best];
+    return code128_first_node(nodes, live_pos[best], mode);
+}
+
+static size_t code128_stream_put(struct code128_stream *st, int pattern, int pattern_length, char *out)
+{
+    char *start = out;
+    int i;
+    for (i = pattern_length - 1; i >= 0; i--) {
+        int bar = (pattern >> i) & 1;
+        if (st->format == CODE128_STREAM_MODULES) {
+            *out++ = bar ? 255 : 0;
+        } else {
+            st->bits = (st->bits << 1) | bar;
+            if (++st->bit_count == 8) {
+                *out++ = (char) st->bits;
+                st->bits = 0;
+                st->bit_count = 0;
+            }
+        }
+    }
+    return out - start;
+}
+
+static size_t code128_stream_put_code(struct code128_stream *st, int code, char *out)
+{
+    st->sum = (st->sum + code * st->weight) % 103;
+    if (st->weight < 103)
+        st->weight++;
+    else
+        st->weight = 1;
+    return code128_stream_put(st, code128_pattern[code], CODE128_CHAR_LEN, out);
+}
+
+// Worst case number of output bytes for the given number of modules
+static size_t code128_stream_bytes(const struct code128_stream *st, size_t modules)
+{
+    if (st->format == CODE128_STREAM_MODULES)
+        return modules;
+    else
+        return (st->bit_count + modules + 7) / 8;
+}
+
+// Write the codes for one node and drop its input from the window.
+static size_t code128_stream_write_node(struct code128_stream *st, int pos, int mode,
+                                        char code, char *out)
+{
+    char *start = out;
+    char new_mode = code128_mode_of_index[mode];
+
+    if (st->mode == 0) {
+        static const int start_codes[] = {
+            CODE128_START_CODE_A, CODE128_START_CODE_B, CODE128_START_CODE_C
+        };
+        out += code128_stream_put(st, 0, CODE128_QUIET_ZONE_LEN, out);
+        st->sum = start_codes[mode];
+        st->weight = 1;
+        out += code128_stream_put(st, code128_pattern[start_codes[mode]], CODE128_CHAR_LEN, out);
+    } else if (st->mode != new_mode) {
+        out += code128_stream_put_code(st, code128_switch_code(st->mode, new_mode), out);
+    }
+    out += code128_stream_put_code(st, code, out);
+
+    st->mode = new_mode;
+    st->window_len -= pos;
+    memmove(st->window, st->window + pos, st->window_len);
+    return out - start;
+}
+
+/**
+ * @brief Start encoding a barcode incrementally
+ *
+ * @param format CODE128_STREAM_MODULES or CODE128_STREAM_PACKED
+ */
+void code128_stream_init(struct code128_stream *st, int format)
+{
+    memset(st, 0, sizeof(*st));
+    st->format = format;
+}
+
+/**
+ * @brief Upper bound on the output of the next push or finish call
+ *
+ * The bound depends on how much input is still held back, so call this
+ * again before each push.
+ *
+ * @param len the number of characters that will be pushed, 0 for finish
+ * @return the number of bytes that out must have room for
+ */
+size_t code128_stream_estimate_len(const struct code128_stream *st, size_t len)
+{
+    size_t modules = 2 * CODE128_CHAR_LEN * (len + st->window_len) // start/switch + code
+                     + CODE128_CHAR_LEN // checksum
+                     + CODE128_STOP_CODE_LEN
+                     + CODE128_QUIET_ZONE_LEN;
+
+    if (st->mode == 0)
+        modules += CODE128_QUIET_ZONE_LEN;
+
+    if (st->format == CODE128_STREAM_MODULES)
+        return modules;
+    else
+        return modules / 8 + 2;
+}
+
+/**
+ * @brief Encode more input
+ *
+ * Input is held back until the best mode to encode it in is known. That's
+ * decided as soon as the shortest encodings of everything seen so far agree
+ * on how to encode the oldest character, which gives the same result as
+ * searching the whole input. If they still disagree after
+ * CODE128_STREAM_WINDOW characters, the choice that's shortest so far is
+ * taken. That only happens in long stretches that encode almost equally well
+ * several ways, and each time costs at most a few codes.
+ *
+ * Unlike code128_encode_raw(), the input may contain NUL characters.
+ *
+ * @return the number of bytes written to out. If the input can't be encoded
+ *         or out is too small, the stream fails and code128_stream_finish()
+ *         will return 0.
+ */
+size_t code128_stream_push(struct code128_stream *st, const char *s, size_t len,
+                           char *out, size_t maxlength)
+{
+    struct code128_node nodes[CODE128_STREAM_WINDOW + 1][4];
+    char *start = out;
+    size_t i;
+
+    for (i = 0; i < len && !st->failed; i++) {
+        st->window[st->window_len++] = s[i];
+
+        for (;;) {
+            int live_pos[8];
+            int live_mode[8];
+            int live_count;
+            int first_pos;
+            int first_mode = 0;
+
+            code128_search_window(st, nodes);
+            live_count = code128_live_nodes(st, nodes, live_pos, live_mode);
+            if (live_count == 0) {
+                // Nothing can encode the last character
+                st->failed = 1;
+                break;
+            }
+
+            first_pos = code128_common_first_node(nodes, live_count, live_pos, live_mode, &first_mode);
+            if (first_pos == 0) {
+                if (st->window_len < CODE128_STREAM_WINDOW)
+                    break;
+
+                first_pos = code128_choose_first_node(st, nodes, live_count, live_pos, live_mode, &first_mode);
+            }
+
+            size_t used = out - start;
+            if (maxlength < used || maxlength - used < code128_stream_bytes(st, CODE128_QUIET_ZONE_LEN + 2 * CODE128_CHAR_LEN)) {
+                st->failed = 1;
+                break;
+            }
+            out += code128_stream_write_node(st, first_pos, first_mode,
+                                             nodes[first_pos][first_mode].code, out);
+        }
+    }
+
+    return out - start;
+}
+
+/**
+ * @brief Encode the remaining input and finish the barcode
+ *
+ * This writes the last codes, the checksum, the stop code and the trailing
+ * quiet zone. In CODE128_STREAM_PACKED format, the last byte is padded with
+ * spaces.
+ *
+ * @return the number of bytes written to out or 0 if the barcode couldn't
+ *         be encoded
+ */
+size_t code128_stream_finish(struct code128_stream *st, char *out, size_t maxlength)
+{
+    struct code128_node nodes[CODE128_STREAM_WINDOW + 1][4];
+    int path_pos[CODE128_STREAM_WINDOW];
+    int path_mode[CODE128_STREAM_WINDOW];
+    int path_len = 0;
+    char *start = out;
+    int n = st->window_len;
+    int best_mode = -1;
+    int m;
+
+    if (st->failed || (n == 0 && st->mode == 0))
+        return 0;
+
+    code128_search_window(st, nodes);
+    for (m = 0; m < 3; m++) {
+        if (nodes[n][m].cost >= 0 &&
+                (best_mode < 0 || nodes[n][m].cost < nodes[n][best_mode].cost))
+            best_mode = m;
+    }
+    if (n > 0 && best_mode < 0)
+        return 0;
+
+    // List the nodes from the end of the window back to the root
+    int pos = n;
+    m = best_mode;
+    while (pos > 0) {
+        path_pos[path_len] = pos;
+        path_mode[path_len] = m;
+        path_len++;
+        int prev = pos - code128_node_width(m, nodes[pos][m].code);
+        m = nodes[pos][m].prev_mode;
+        pos = prev;
+    }
+
+    size_t needed = code128_stream_bytes(st, 2 * CODE128_CHAR_LEN * path_len
+                                         + CODE128_CHAR_LEN
+                                         + CODE128_STOP_CODE_LEN
+                                         + CODE128_QUIET_ZONE_LEN
+                                         + (st->mode == 0 ? CODE128_QUIET_ZONE_LEN : 0));
+    if (maxlength < needed) {
+        st->failed = 1;
+        return 0;
+    }
+
+    // The window shrinks as nodes are written, so positions are relative
+    // to the previous node.
+    int done = 0;
+    while (path_len > 0) {
+        path_len--;
+        pos = path_pos[path_len];
+        m = path_mode[path_len];
+        out += code128_stream_write_node(st, pos - done, m, nodes[pos][m].code, out);
+        done = pos;
+    }
+
+    out += code128_stream_put(st, code128_pattern[st->sum], CODE128_CHAR_LEN, out);
+    out += code128_stream_put(st, code128_stop_pattern, CODE128_STOP_CODE_LEN, out);
+    out += code128_stream_put(st, 0, CODE128_QUIET_ZONE_LEN, out);
+    if (st->bit_count > 0)
+        out += code128_stream_put(st, 0, 8 - st->bit_count, out);
+
+    return out - start;
+}
+
+static unsigned char code128_gray(double coverage)
+{
+    int value = 255 - (int) (coverage * 255 + 0.5);
+    if (value < 0)
+        return 0;
+    else if (value > 255)
+        return 255;
+    else
+        return value;
+}
+
+/**
+ * @brief Render barcode data as 8-bit grayscale pixels
+ *
+ * Each module is module_width pixels wide, which doesn't need to be a whole
+ * number. Pixels that a bar edge passes through are set from the fraction
+ * of them covered by bars, so 0 is all bar and 255 is all space. Pixels
+ * entirely inside a bar or space are filled a whole run at a time, so the
+ * per-pixel work only happens at edges.
+ *
+ * @param modules barcode data from one of the encode functions
+ * @param len the number of modules
+ * @param out where to write the first row, or NULL to only get the width
+ * @param stride the distance in bytes between the starts of rows in out
+ * @param rows the number of rows to write. They're all the same. Nothing is
+ *             written if this is 0.
+ * @return the width of a row in pixels
+ */
+size_t code128_render_gray(const char *modules, size_t len, double module_width,
+                           unsigned char *out, size_t stride, size_t rows)
+{
+    size_t width = (size_t) (len * module_width);
+    if (width < len * module_width)
+        width++;
+    if (out == NULL || width == 0 || rows == 0)
+        return width;
+
+    size_t pixel = 0;       // The first pixel that hasn't been written
+    double coverage = 0;    // How much of that pixel is covered by bars so far
+    size_t i = 0;
+    while (i < len) {
+        // Find the end of this bar or space
+        size_t j = i + 1;
+        while (j < len && !modules[j] == !modules[i])
+            j++;
+
+        int bar = modules[i] != 0;
+        double start = i * module_width;
+        double end = j * module_width;
+
+        if (end < pixel + 1) {
+            // Starts and ends in the same pixel
+            if (bar)
+                coverage += end - start;
+        } else {
+            if (bar)
+                coverage += pixel + 1 - start;
+            out[pixel++] = code128_gray(coverage);
+
+            size_t full = (size_t) end;
+            if (full > width)
+                full = width;
+            memset(out + pixel, bar ? 0 : 255, full - pixel);
+            pixel = full;
+            coverage = bar ? end - full : 0;
+        }
+        i = j;
+    }
+    if (pixel < width)
+        out[pixel] = code128_gray(coverage);
+
+    for (i = 1; i < rows; i++)
+        memcpy(out + i * stride, out, width);
+
+    return width;
 }
@@ -39,6 +39,36 @@ extern "C" {
 size_t code128_estimate_len(const char *s);
 size_t code128_encode_gs1(const char *s, char *out, size_t maxlength);
 size_t code128_encode_raw(const char *s, char *out, size_t maxlength);
+size_t code128_gs1_hri(const char *s, char *out, size_t maxlength);
+size_t code128_render_gray(const char *modules, size_t len, double module_width,
+                           unsigned char *out, size_t stride, size_t rows);
+
+// Number of input characters the streaming encoder may hold back while
+// it decides which mode to encode them in.
+#define CODE128_STREAM_WINDOW 64
+
+// Output formats for the streaming encoder
+#define CODE128_STREAM_MODULES 0 // One byte per module, 0x00 or 0xff
+#define CODE128_STREAM_PACKED  1 // Eight modules per byte, MSB first, 1 = bar
+
+// State for encoding a barcode incrementally. The fields are private, but
+// the struct is declared here so that callers can allocate it anywhere.
+struct code128_stream {
+    char window[CODE128_STREAM_WINDOW + 1]; // Input that hasn't been encoded yet
+    int window_len;
+    char mode;          // Mode of the last code written, 0 before the start code
+    int sum;            // Checksum so far
+    int weight;         // Checksum weight of the next code
+    int format;
+    unsigned int bits;  // Packed modules that don't fill a byte yet
+    int bit_count;
+    int failed;
+};
+
+void code128_stream_init(struct code128_stream *st, int format);
+size_t code128_stream_estimate_len(const struct code128_stream *st, size_t len);
+size_t code128_stream_push(struct code128_stream *st, const char *s, size_t len, char *out, size_t maxlength);
+size_t code128_stream_finish(struct code128_stream *st, char *out, size_t maxlength);
 
 #ifdef __cplusplus
 }
@@ -23,6 +23,8 @@
 #include <stdio.h>
 #include <err.h>
 #include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <libpng/png.h>
 
@@ -40,25 +42,188 @@ static void png_warning_callback(png_structp png_ptr, const char *msg)
     warnx("libpng: %s", msg);
 }
 
-int main(int argc, char *argv[])
+#define GLYPH_WIDTH   5
+#define GLYPH_HEIGHT  7
+#define GLYPH_ADVANCE 6 // Glyph width plus one column of space
+
+// 5x7 font for ' ' to '~'. Each byte is a column, least significant bit
+// at the top.
+static const unsigned char font5x7[][GLYPH_WIDTH] = {
+    {0x00, 0x00, 0x00, 0x00, 0x00}, // ' '
+    {0x00, 0x00, 0x5f, 0x00, 0x00}, // '!'
+    {0x00, 0x07, 0x00, 0x07, 0x00}, // '"'
+    {0x14, 0x7f, 0x14, 0x7f, 0x14}, // '#'
+    {0x24, 0x2a, 0x7f, 0x2a, 0x12}, // '$'
+    {0x23, 0x13, 0x08, 0x64, 0x62}, // '%'
+    {0x36, 0x49, 0x55, 0x22, 0x50}, // '&'
+    {0x00, 0x05, 0x03, 0x00, 0x00}, // '\''
+    {0x00, 0x1c, 0x22, 0x41, 0x00}, // '('
+    {0x00, 0x41, 0x22, 0x1c, 0x00}, // ')'
+    {0x08, 0x2a, 0x1c, 0x2a, 0x08}, // '*'
+    {0x08, 0x08, 0x3e, 0x08, 0x08}, // '+'
+    {0x00, 0x50, 0x30, 0x00, 0x00}, // ','
+    {0x08, 0x08, 0x08, 0x08, 0x08}, // '-'
+    {0x00, 0x60, 0x60, 0x00, 0x00}, // '.'
+    {0x20, 0x10, 0x08, 0x04, 0x02}, // '/'
+    {0x3e, 0x51, 0x49, 0x45, 0x3e}, // '0'
+    {0x00, 0x42, 0x7f, 0x40, 0x00}, // '1'
+    {0x42, 0x61, 0x51, 0x49, 0x46}, // '2'
+    {0x21, 0x41, 0x45, 0x4b, 0x31}, // '3'
+    {0x18, 0x14, 0x12, 0x7f, 0x10}, // '4'
+    {0x27, 0x45, 0x45, 0x45, 0x39}, // '5'
+    {0x3c, 0x4a, 0x49, 0x49, 0x30}, // '6'
+    {0x01, 0x71, 0x09, 0x05, 0x03}, // '7'
+    {0x36, 0x49, 0x49, 0x49, 0x36}, // '8'
+    {0x06, 0x49, 0x49, 0x29, 0x1e}, // '9'
+    {0x00, 0x36, 0x36, 0x00, 0x00}, // ':'
+    {0x00, 0x56, 0x36, 0x00, 0x00}, // ';'
+    {0x08, 0x14, 0x22, 0x41, 0x00}, // '<'
+    {0x14, 0x14, 0x14, 0x14, 0x14}, // '='
+    {0x00, 0x41, 0x22, 0x14, 0x08}, // '>'
+    {0x02, 0x01, 0x51, 0x09, 0x06}, // '?'
+    {0x32, 0x49, 0x79, 0x41, 0x3e}, // '@'
+    {0x7e, 0x11, 0x11, 0x11, 0x7e}, // 'A'
+    {0x7f, 0x49, 0x49, 0x49, 0x36}, // 'B'
+    {0x3e, 0x41, 0x41, 0x41, 0x22}, // 'C'
+    {0x7f, 0x41, 0x41, 0x22, 0x1c}, // 'D'
+    {0x7f, 0x49, 0x49, 0x49, 0x41}, // 'E'
+    {0x7f, 0x09, 0x09, 0x09, 0x01}, // 'F'
+    {0x3e, 0x41, 0x49, 0x49, 0x7a}, // 'G'
+    {0x7f, 0x08, 0x08, 0x08, 0x7f}, // 'H'
+    {0x00, 0x41, 0x7f, 0x41, 0x00}, // 'I'
+    {0x20, 0x40, 0x41, 0x3f, 0x01}, // 'J'
+    {0x7f, 0x08, 0x14, 0x22, 0x41}, // 'K'
+    {0x7f, 0x40, 0x40, 0x40, 0x40}, // 'L'
+    {0x7f, 0x02, 0x0c, 0x02, 0x7f}, // 'M'
+    {0x7f, 0x04, 0x08, 0x10, 0x7f}, // 'N'
+    {0x3e, 0x41, 0x41, 0x41, 0x3e}, // 'O'
+    {0x7f, 0x09, 0x09, 0x09, 0x06}, // 'P'
+    {0x3e, 0x41, 0x51, 0x21, 0x5e}, // 'Q'
+    {0x7f, 0x09, 0x19, 0x29, 0x46}, // 'R'
+    {0x46, 0x49, 0x49, 0x49, 0x31}, // 'S'
+    {0x01, 0x01, 0x7f, 0x01, 0x01}, // 'T'
+    {0x3f, 0x40, 0x40, 0x40, 0x3f}, // 'U'
+    {0x1f, 0x20, 0x40, 0x20, 0x1f}, // 'V'
+    {0x3f, 0x40, 0x38, 0x40, 0x3f}, // 'W'
+    {0x63, 0x14, 0x08, 0x14, 0x63}, // 'X'
+    {0x07, 0x08, 0x70, 0x08, 0x07}, // 'Y'
+    {0x61, 0x51, 0x49, 0x45, 0x43}, // 'Z'
+    {0x00, 0x7f, 0x41, 0x41, 0x00}, // '['
+    {0x02, 0x04, 0x08, 0x10, 0x20}, // '\\'
+    {0x00, 0x41, 0x41, 0x7f, 0x00}, // ']'
+    {0x04, 0x02, 0x01, 0x02, 0x04}, // '^'
+    {0x40, 0x40, 0x40, 0x40, 0x40}, // '_'
+    {0x00, 0x01, 0x02, 0x04, 0x00}, // '`'
+    {0x20, 0x54, 0x54, 0x54, 0x78}, // 'a'
+    {0x7f, 0x48, 0x44, 0x44, 0x38}, // 'b'
+    {0x38, 0x44, 0x44, 0x44, 0x20}, // 'c'
+    {0x38, 0x44, 0x44, 0x48, 0x7f}, // 'd'
+    {0x38, 0x54, 0x54, 0x54, 0x18}, // 'e'
+    {0x08, 0x7e, 0x09, 0x01, 0x02}, // 'f'
+    {0x0c, 0x52, 0x52, 0x52, 0x3e}, // 'g'
+    {0x7f, 0x08, 0x04, 0x04, 0x78}, // 'h'
+    {0x00, 0x44, 0x7d, 0x40, 0x00}, // 'i'
+    {0x20, 0x40, 0x44, 0x3d, 0x00}, // 'j'
+    {0x7f, 0x10, 0x28, 0x44, 0x00}, // 'k'
+    {0x00, 0x41, 0x7f, 0x40, 0x00}, // 'l'
+    {0x7c, 0x04, 0x18, 0x04, 0x78}, // 'm'
+    {0x7c, 0x08, 0x04, 0x04, 0x78}, // 'n'
+    {0x38, 0x44, 0x44, 0x44, 0x38}, // 'o'
+    {0x7c, 0x14, 0x14, 0x14, 0x08}, // 'p'
+    {0x08, 0x14, 0x14, 0x18, 0x7c}, // 'q'
+    {0x7c, 0x08, 0x04, 0x04, 0x08}, // 'r'
+    {0x48, 0x54, 0x54, 0x54, 0x20}, // 's'
+    {0x04, 0x3f, 0x44, 0x40, 0x20}, // 't'
+    {0x3c, 0x40, 0x40, 0x20, 0x7c}, // 'u'
+    {0x1c, 0x20, 0x40, 0x20, 0x1c}, // 'v'
+    {0x3c, 0x40, 0x30, 0x40, 0x3c}, // 'w'
+    {0x44, 0x28, 0x10, 0x28, 0x44}, // 'x'
+    {0x0c, 0x50, 0x50, 0x50, 0x3c}, // 'y'
+    {0x44, 0x64, 0x54, 0x4c, 0x44}, // 'z'
+    {0x00, 0x08, 0x36, 0x41, 0x00}, // '{'
+    {0x00, 0x00, 0x7f, 0x00, 0x00}, // '|'
+    {0x00, 0x41, 0x36, 0x08, 0x00}, // '}'
+    {0x08, 0x04, 0x08, 0x10, 0x08}  // '~'
+};
+
+// Set the pixels for one row of text centered in a packed 1 bit per pixel
+// row. y counts down from the top of the text. Callers make the row wide
+// enough for the text, but anything outside it is clipped.
+static void draw_text_row(png_byte *row, int width, const char *text, int scale, int y)
 {
-    char out[4096];
-    int width;
-    int height = 40;
+    int len = strlen(text);
+    int left = (width - (len * GLYPH_ADVANCE - 1) * scale) / 2;
+    int bit = 1 << (y / scale);
+    int i, col, x;
 
-    if (argc < 3) {
-        printf("%s <output.png> <string to encode>\n", argv[0]);
-        exit(EXIT_FAILURE);
+    for (i = 0; i < len; i++) {
+        if (text[i] < ' ' || text[i] > '~')
+            continue;
+
+        const unsigned char *glyph = font5x7[text[i] - ' '];
+        for (col = 0; col < GLYPH_WIDTH; col++) {
+            if (!(glyph[col] & bit))
+                continue;
+
+            int start = left + (i * GLYPH_ADVANCE + col) * scale;
+            for (x = start; x < start + scale; x++) {
+                if (x >= 0 && x < width)
+                    row[x >> 3] |= 0x80 >> (x & 7);
+            }
+        }
     }
+}
 
-    const char *str = argv[2];
-    width = code128_estimate_len(str);
-    width = code128_encode_gs1(str, out, width);
+// The bar row is made once and written for the whole bar height. It's
+// centered when the text is wider than the bars. Text is set in packed
+// rows, 8 pixels per byte, which 1 bit images write as is and grayscale
+// images expand to 8 bits per pixel.
+static void write_rows(png_structp png_ptr, const char *out, int modules, double module_width,
+                       int bar_width, int width, int height, const char *text, int text_height)
+{
+    int text_scale = text_height / (GLYPH_HEIGHT + 2);
+    int left = (width - bar_width) / 2;
+    int row_bytes = (width + 7) / 8;
+    int gray = module_width > 0;
+    png_byte bars[gray ? width : row_bytes];
+    png_byte packed[row_bytes];
+    png_byte row[width];
+    int i, x;
 
-    if (width == 0)
-        errx(EXIT_FAILURE, "Invalid characters in string");
+    if (gray) {
+        memset(bars, 255, width);
+        code128_render_gray(out, modules, module_width, bars + left, width, 1);
+    } else {
+        memset(bars, 0, row_bytes);
+        for (i = 0; i < bar_width; i++) {
+            if (out[i])
+                bars[(left + i) >> 3] |= 0x80 >> ((left + i) & 7);
+        }
+    }
+    for (i = 0; i < height; i++)
+        png_write_row(png_ptr, bars);
+
+    for (i = 0; i < text_height; i++) {
+        int y = i - text_scale;
+        memset(packed, 0, row_bytes);
+        if (y >= 0 && y < GLYPH_HEIGHT * text_scale)
+            draw_text_row(packed, width, text, text_scale, y);
+
+        if (gray) {
+            for (x = 0; x < width; x++)
+                row[x] = (packed[x >> 3] & (0x80 >> (x & 7))) ? 0 : 255;
+            png_write_row(png_ptr, row);
+        } else {
+            png_write_row(png_ptr, packed);
+        }
+    }
+}
 
-    FILE *fp = fopen(argv[1], "wb");
+// module_width is 0 for a 1 bit image with one pixel per module
+static void write_png(const char *filename, const char *out, int modules, double module_width,
+                      int bar_width, int width, int height, const char *text, int text_height)
+{
+    FILE *fp = fopen(filename, "wb");
     if (!fp)
         err(EXIT_FAILURE, "can't open output");
 
@@ -85,31 +250,94 @@ int main(int argc, char *argv[])
 
     png_init_io(png_ptr, fp);
 
-    png_set_IHDR(png_ptr, info_ptr, width, height,
-                 1, PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_NONE,
+    png_set_IHDR(png_ptr, info_ptr, width, height + text_height,
+                 module_width > 0 ? 8 : 1, PNG_COLOR_TYPE_GRAY, PNG_INTERLACE_NONE,
                  PNG_COMPRESSION_TYPE_DEFAULT, PNG_FILTER_TYPE_DEFAULT);
 
     png_text note;
     memset(&note, 0, sizeof(note));
     note.compression = PNG_TEXT_COMPRESSION_NONE;
     note.key = "gs1-128";
-    note.text = argv[1];
-    note.text_length = strlen(argv[1]);
+    note.text = (char *) filename;
+    note.text_length = strlen(filename);
 
     png_set_text(png_ptr, info_ptr, &note, 1);
     png_write_info(png_ptr, info_ptr);
-    png_set_packing(png_ptr);
-    png_set_invert_mono(png_ptr);
+    if (module_width == 0)
+        png_set_invert_mono(png_ptr);
+
+    write_rows(png_ptr, out, modules, module_width, bar_width, width, height, text, text_height);
 
-    png_byte *row_pointers[height];
-    int i;
-    for (i = 0; i < height; i++)
-        row_pointers[i] = (png_byte*) out;
-    png_write_image(png_ptr, row_pointers);
     png_write_end(png_ptr, info_ptr);
     png_destroy_write_struct(&png_ptr, &info_ptr);
 
     fclose(fp);
-    return 0;
 }
 
+int main(int argc, char *argv[])
+{
+    char out[4096];
+    int width;
+    int height = 40;
+    long text_scale = 0;
+    double module_width = 0;
+    char *end;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:t:")) != -1) {
+        switch (opt) {
+        case 'm':
+            module_width = strtod(optarg, &end);
+            if (end == optarg || *end != '\0' ||
+                    !(module_width >= 0.1 && module_width <= 100))
+                errx(EXIT_FAILURE, "Module width must be 0.1 to 100 pixels");
+            break;
+        case 't':
+            text_scale = strtol(optarg, &end, 10);
+            if (end == optarg || *end != '\0' || text_scale < 1 || text_scale > 4)
+                errx(EXIT_FAILURE, "Text size must be 1 to 4");
+            break;
+        default:
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (argc - optind < 2) {
+        printf("%s [-m module width] [-t text size] <output.png> <string to encode>\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    const char *filename = argv[optind];
+    const char *str = argv[optind + 1];
+    width = code128_estimate_len(str);
+    width = code128_encode_gs1(str, out, width);
+
+    if (width == 0)
+        errx(EXIT_FAILURE, "Invalid characters in string");
+
+    // With a module width, write 8 bit grayscale and keep the bars 40
+    // modules tall.
+    int modules = width;
+    if (module_width > 0) {
+        width = code128_render_gray(out, modules, module_width, NULL, 0, 0);
+        height = (int) (height * module_width + 0.5);
+    }
+
+    // The text goes under the bars with a gap of text_scale pixels above
+    // and below it.
+    char text[2 * strlen(str) + 1];
+    int text_height = 0;
+    int image_width = width;
+    if (text_scale > 0 && code128_gs1_hri(str, text, sizeof(text)) > 0) {
+        text_height = (GLYPH_HEIGHT + 2) * text_scale;
+
+        // Make the image wider rather than cut off any of the text. That
+        // leaves at least one column of space on each side.
+        int text_width = ((int) strlen(text) * GLYPH_ADVANCE + 1) * text_scale;
+        if (text_width > image_width)
+            image_width = text_width;
+    }
+
+    write_png(filename, out, modules, module_width, width, image_width, height, text, text_height);
+    return 0;
+}
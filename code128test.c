@@ -0,0 +1,332 @@
+// Copyright (c) 2015, LKC Technologies, Inc.
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are met:
+//
+// Redistributions of source code must retain the above copyright notice, this
+// list of conditions and the following disclaimer. Redistributions in binary
+// form must reproduce the above copyright notice, this list of conditions and
+// the following disclaimer in the documentation and/or other materials
+// provided with the distribution. THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT
+// HOLDERS AND CONTRIBUTORS "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES,
+// INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+// FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+// COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA,
+// OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+// LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+// NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+// EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+// Checks of the library functions that zbarimg can't check through
+// code128png. Pass the strings to stream on the commandline.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "code128.h"
+
+#define QUIET_ZONE_LEN 10
+#define CHAR_LEN       11
+#define STOP_PATTERN   6379
+
+// Same as the table in code128.c
+static const int patterns[] = {
+    1740, 1644, 1638, 1176, 1164, 1100, 1224, 1220, 1124, 1608, 1604, 1572,
+    1436, 1244, 1230, 1484, 1260, 1254, 1650, 1628, 1614, 1764, 1652, 1902,
+    1868, 1836, 1830, 1892, 1844, 1842, 1752, 1734, 1590, 1304, 1112, 1094,
+    1416, 1128, 1122, 1672, 1576, 1570, 1464, 1422, 1134, 1496, 1478, 1142,
+    1910, 1678, 1582, 1768, 1762, 1774, 1880, 1862, 1814, 1896, 1890, 1818,
+    1914, 1602, 1930, 1328, 1292, 1200, 1158, 1068, 1062, 1424, 1412, 1232,
+    1218, 1076, 1074, 1554, 1616, 1978, 1556, 1146, 1340, 1212, 1182, 1508,
+    1268, 1266, 1956, 1940, 1938, 1758, 1782, 1974, 1400, 1310, 1118, 1512,
+    1506, 1960, 1954, 1502, 1518, 1886, 1966, 1668, 1680, 1692
+};
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { \
+        if (!(cond)) { \
+            printf(__VA_ARGS__); \
+            printf("\n"); \
+            failures++; \
+        } \
+    } while (0)
+
+static int read_bits(const char *modules, size_t pos, int count)
+{
+    int value = 0;
+    int i;
+    for (i = 0; i < count; i++)
+        value = (value << 1) | (modules[pos + i] != 0);
+    return value;
+}
+
+// Decode barcode data back to the raw string. Returns the length of the
+// string or -1 if the data isn't a valid barcode.
+static int decode(const char *modules, size_t len, char *text)
+{
+    int codes[1024];
+    int count = 0;
+    size_t pos = QUIET_ZONE_LEN;
+    int i;
+
+    while (pos + CHAR_LEN + 2 + QUIET_ZONE_LEN < len) {
+        int value = read_bits(modules, pos, CHAR_LEN);
+        int code;
+
+        for (code = 0; code < 106; code++) {
+            if (patterns[code] == value)
+                break;
+        }
+        if (code == 106 || count == 1024)
+            return -1;
+        codes[count++] = code;
+        pos += CHAR_LEN;
+    }
+
+    if (count < 3 || pos + CHAR_LEN + 2 + QUIET_ZONE_LEN != len ||
+            read_bits(modules, pos, CHAR_LEN + 2) != STOP_PATTERN ||
+            read_bits(modules, len - QUIET_ZONE_LEN, QUIET_ZONE_LEN) != 0)
+        return -1;
+
+    int sum = codes[0];
+    for (i = 1; i < count - 1; i++)
+        sum += codes[i] * i;
+    if (sum % 103 != codes[count - 1])
+        return -1;
+
+    char mode = codes[0] == 103 ? 'a' : codes[0] == 104 ? 'b' : 'c';
+    int n = 0;
+    for (i = 1; i < count - 1; i++) {
+        int code = codes[i];
+        if (code == 102) {
+            text[n++] = CODE128_FNC1;
+        } else if (mode == 'c' && code < 100) {
+            text[n++] = '0' + code / 10;
+            text[n++] = '0' + code % 10;
+        } else if (mode != 'c' && code < 64) {
+            text[n++] = code + ' ';
+        } else if (mode == 'b' && code < 96) {
+            text[n++] = code + ' ';
+        } else if (mode == 'a' && code < 96) {
+            text[n++] = code - 64;
+        } else if ((mode == 'a' && code == 101) || (mode == 'b' && code == 100)) {
+            text[n++] = CODE128_FNC4;
+        } else if (code == 99) {
+            mode = 'c';
+        } else if (code == 100 && mode != 'b') {
+            mode = 'b';
+        } else if (code == 101 && mode != 'a') {
+            mode = 'a';
+        } else {
+            return -1;
+        }
+    }
+    return n;
+}
+
+static size_t append(int format, const char *out, size_t written, char *modules, size_t total)
+{
+    size_t i;
+
+    if (format == CODE128_STREAM_MODULES) {
+        memcpy(modules + total, out, written);
+        return total + written;
+    }
+
+    for (i = 0; i < written * 8; i++)
+        modules[total++] = (out[i >> 3] & (0x80 >> (i & 7))) ? 255 : 0;
+    return total;
+}
+
+// Encode s in chunks and return the barcode as one byte per module. Packed
+// output is padded to whole bytes, so the length is taken from the last
+// bar plus the quiet zone.
+static size_t stream_encode(const char *s, size_t len, int format, size_t chunk, char *modules)
+{
+    struct code128_stream st;
+    char out[4096];
+    size_t total = 0;
+    size_t i, n, written;
+
+    code128_stream_init(&st, format);
+    for (i = 0; i < len; i += n) {
+        n = len - i < chunk ? len - i : chunk;
+        written = code128_stream_push(&st, s + i, n, out, code128_stream_estimate_len(&st, n));
+        total = append(format, out, written, modules, total);
+    }
+
+    written = code128_stream_finish(&st, out, code128_stream_estimate_len(&st, 0));
+    if (written == 0)
+        return 0;
+    total = append(format, out, written, modules, total);
+
+    while (total > 0 && !modules[total - 1])
+        total--;
+    return total + QUIET_ZONE_LEN;
+}
+
+// Stream len characters of s and check that they decode. The barcode must
+// be between expected and expected + slack modules long. If expected is 0,
+// it's taken from code128_encode_raw() for input that fits in the window.
+static void test_stream(const char *name, const char *s, size_t len,
+                        size_t expected, size_t slack)
+{
+    static const int formats[] = { CODE128_STREAM_MODULES, CODE128_STREAM_PACKED };
+    static const size_t chunks[] = { 1, 3, 7, 1000 };
+    char raw[32768];
+    char modules[32768];
+    char text[1024];
+    size_t f, c;
+
+    // Longer input would make code128_encode_raw() slow, and it can't
+    // encode NUL.
+    if (expected == 0 && len < CODE128_STREAM_WINDOW && memchr(s, 0, len) == NULL)
+        expected = code128_encode_raw(s, raw, code128_estimate_len(s));
+
+    for (f = 0; f < 2; f++) {
+        for (c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+            size_t modules_len = stream_encode(s, len, formats[f], chunks[c], modules);
+            int n = modules_len ? decode(modules, modules_len, text) : -1;
+
+            CHECK(n == (int) len && memcmp(text, s, len) == 0,
+                  "Stream encode of '%s' (format %d, chunk %zu) failed",
+                  name, formats[f], chunks[c]);
+
+            if (expected > 0)
+                CHECK(modules_len >= expected && modules_len <= expected + slack,
+                      "Stream length of '%s' is %zu, expected %zu to %zu",
+                      name, modules_len, expected, expected + slack);
+        }
+    }
+}
+
+// Length of a barcode with the given number of codes, counting the start
+// code but not the checksum
+static size_t barcode_len(size_t codes)
+{
+    return QUIET_ZONE_LEN + CHAR_LEN * (codes + 1) + CHAR_LEN + 2 + QUIET_ZONE_LEN;
+}
+
+static void test_stream_special(void)
+{
+    static const char gs1[] = "\xf1" "0112345678901231" "\xf1" "10AB";
+    static const char odd_digits[] = "\xf1" "123" "\xf1" "45678" "\xf1" "9";
+    static const char fnc4[] = "A" "\xf4" "b";
+    static const char nul[] = "AB\0CD";
+    char long_input[256];
+
+    test_stream("GS1 with FNC1", gs1, sizeof(gs1) - 1, 0, 0);
+    test_stream("FNC1 between odd digit runs", odd_digits, sizeof(odd_digits) - 1, 0, 0);
+    test_stream("FNC4", fnc4, sizeof(fnc4) - 1, 0, 0);
+
+    // Start A and one code per character
+    test_stream("embedded NUL", nul, sizeof(nul) - 1, barcode_len(6), 0);
+
+    // Longer than the window, so these go through forced choices. Digits
+    // stay in C and lowercase stays in B.
+    memset(long_input, '7', 200);
+    test_stream("200 digits", long_input, 200, barcode_len(1 + 100), 0);
+    memset(long_input, 'a', 200);
+    test_stream("200 lowercase", long_input, 200, barcode_len(1 + 200), 0);
+
+    // The start code depends on the last character, which is too far away
+    // to see. Guessing wrong costs one switch code.
+    memset(long_input, 'A', 100);
+    long_input[100] = 'a';
+    test_stream("100 uppercase and a lowercase", long_input, 101, barcode_len(1 + 101), CHAR_LEN);
+}
+
+static void test_stream_small_buffer(void)
+{
+    struct code128_stream st;
+    char out[100];
+    char more[100];
+
+    // Finishing with the whole input still held back writes the leading
+    // quiet zone as well.
+    code128_stream_init(&st, CODE128_STREAM_MODULES);
+    CHECK(code128_stream_push(&st, "A", 1, more, sizeof(more)) == 0,
+          "Push of 'A' wrote output too early");
+    CHECK(code128_stream_estimate_len(&st, 0) >= 66, "Finish estimate too small");
+
+    memset(out, 0x55, sizeof(out));
+    CHECK(code128_stream_finish(&st, out, 56) == 0, "Finish into a small buffer didn't fail");
+    int i;
+    for (i = 56; i < (int) sizeof(out); i++) {
+        if (out[i] != 0x55)
+            break;
+    }
+    CHECK(i == sizeof(out), "Finish wrote past the end of the buffer");
+}
+
+static void test_hri(void)
+{
+    static const struct {
+        const char *input;
+        const char *hri;
+    } cases[] = {
+        // Fixed length AIs don't need FNC1 after them
+        { "[FNC1] 01 09501101020917 17 190508", "(01)09501101020917(17)190508" },
+        { "[FNC1] 00 12345678 0000000001", "(00)123456780000000001" },
+        // Variable length AIs end at FNC1
+        { "[FNC1] 10 ABC123 [FNC1] 21 XYZ", "(10)ABC123(21)XYZ" },
+        // 3 and 4 digit AIs
+        { "[FNC1] 421 52812345", "(421)52812345" },
+        { "[FNC1] 3103 000189 01 09501101020917", "(3103)000189(01)09501101020917" },
+        // Not GS1, so copied without the spaces that encoding drops
+        { "Hello World", "HelloWorld" },
+    };
+    char out[64];
+    size_t i;
+
+    for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        size_t len = code128_gs1_hri(cases[i].input, out, sizeof(out));
+        CHECK(len == strlen(cases[i].hri) && strcmp(out, cases[i].hri) == 0,
+              "HRI of '%s' is '%s', expected '%s'",
+              cases[i].input, len ? out : "", cases[i].hri);
+    }
+
+    // "(01)09501101020917" needs 19 bytes with the NUL
+    CHECK(code128_gs1_hri("[FNC1] 01 09501101020917", out, 18) == 0,
+          "HRI into a buffer that's too small didn't fail");
+    CHECK(code128_gs1_hri("[FNC1] 01 09501101020917", out, 19) == 18,
+          "HRI into a buffer that's just big enough failed");
+    CHECK(code128_gs1_hri("A", out, 0) == 0, "HRI into an empty buffer didn't fail");
+}
+
+static void test_render_gray(void)
+{
+    // A bar and a space, 1.5 pixels each
+    const char modules[] = { (char) 255, 0 };
+    unsigned char out[8];
+
+    CHECK(code128_render_gray(modules, 2, 1.5, NULL, 0, 0) == 3, "Gray width is wrong");
+
+    memset(out, 0x55, sizeof(out));
+    code128_render_gray(modules, 2, 1.5, out, 4, 0);
+    CHECK(out[0] == 0x55, "Gray render with no rows wrote something");
+
+    code128_render_gray(modules, 2, 1.5, out, 4, 2);
+    CHECK(out[0] == 0 && out[1] == 127 && out[2] == 255 && out[3] == 0x55,
+          "Gray row is %d %d %d %d", out[0], out[1], out[2], out[3]);
+    CHECK(memcmp(out, out + 4, 3) == 0 && out[7] == 0x55, "Gray second row is wrong");
+}
+
+int main(int argc, char *argv[])
+{
+    int i;
+
+    for (i = 1; i < argc; i++)
+        test_stream(argv[i], argv[i], strlen(argv[i]), 0, 0);
+    test_stream_special();
+    test_stream_small_buffer();
+    test_hri();
+    test_render_gray();
+
+    return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -2,7 +2,8 @@
 
 # Code128 unit test
 #
-# This test uses zbarimg to check the encoding. The tool doesn't
+# This test runs code128test to check the library functions directly,
+# then uses zbarimg to check the encoding. The tool doesn't
 # report the FNC1 code, so the tests are lacking, but most other
 # characters used in real barcodes are covered.
 #
@@ -24,17 +25,26 @@ TEST_STRINGS="A AA AAA aaaa AaAa abcd ABCD\
 # zbarimg is buggy. The following strings have to be tested manually.
 ZBARIMG_BROKE_STRINGS="a aa 1234"
 
-for str in $TEST_STRINGS; do
-    if ! ./code128png test.png "${str}"; then
-        echo "Encode of '${str}' failed."
-        exit 1
-    fi
-     
-    result=$(zbarimg -q --raw test.png)
-    if [ "${result}" != "${str}" ]; then
-        echo "Verification of '${str}' failed. Got '${result}'"
-        exit 1
-    fi
+if ! ./code128test $TEST_STRINGS; then
+    echo "Library checks failed."
+    exit 1
+fi
+
+# Text under the bars and grayscale edges shouldn't get in the way of
+# decoding.
+for opts in "" "-t 1" "-t 3" "-m 2.5" "-m 3.9 -t 2"; do
+    for str in $TEST_STRINGS; do
+        if ! ./code128png ${opts} test.png "${str}"; then
+            echo "Encode of '${str}' with '${opts}' failed."
+            exit 1
+        fi
+
+        result=$(zbarimg -q --raw test.png)
+        if [ "${result}" != "${str}" ]; then
+            echo "Verification of '${str}' with '${opts}' failed. Got '${result}'"
+            exit 1
+        fi
+    done
 done
 rm -f test.png
 